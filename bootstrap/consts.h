@@ -263,4 +263,6 @@
 #define SYSNR_LOG_SERIAL    0x3
 // Syscall to alloc/dealloc heap memory.
 #define SYSNR_SBRK          0x4
+// Syscall to write raw bytes to the serial console.
+#define SYSNR_WRITE_SERIAL  0x5
 // ============================================================================= 
@@ -0,0 +1,185 @@
+#!/bin/env python3
+
+# This script extracts the frames captured by the application from a dump of
+# the serial console and converts them into PNG files. See src/capture.h for
+# the format of a captured frame.
+# Usage:
+#   ./decode_capture.py <serial dump filename> [<output prefix>]
+# The frames are written to <output prefix><index>.png, the default prefix
+# being "frame".
+
+import struct
+import sys
+import zlib
+
+# Magic value announcing a captured frame in the serial output.
+CAPTURE_MAGIC = b"\x00KR8CAP\x00"
+# QOI end marker.
+QOI_END_MARKER = b"\x00" * 7 + b"\x01"
+# Maximum number of pixels encoded by a single QOI byte (QOI_OP_RUN).
+QOI_MAX_RUN = 62
+
+# Exception raised when a captured frame is invalid or truncated.
+class CorruptFrame(Exception):
+    pass
+
+# Read the entire content of a file.
+# @param filename: The name of the file to read.
+# @return: A bytes object containing the entire file.
+def read_bytes(filename):
+    fd = open(filename, "rb")
+    content = fd.read()
+    fd.close()
+    return content
+
+# Decode a QOI stream.
+# @param data: A bytes object containing the QOI stream.
+# @param offset: The offset of the QOI stream in data.
+# @return: A tuple (width, height, pixels, size) where pixels is a bytearray of
+# RGB triplets in row-major order and size the size of the QOI stream in bytes.
+# Raises CorruptFrame if the stream is invalid or truncated.
+def decode_qoi(data, offset):
+    if len(data) < offset + 14:
+        raise CorruptFrame("Truncated QOI header")
+    magic, width, height, channels, colorspace = \
+        struct.unpack_from(">4sIIBB", data, offset)
+    if magic != b"qoif":
+        raise CorruptFrame("Invalid QOI magic")
+    pos = offset + 14
+    # Reject sizes that cannot possibly fit in the remaining data before
+    # allocating the pixels.
+    if width * height > (len(data) - pos) * QOI_MAX_RUN:
+        raise CorruptFrame("Truncated QOI stream")
+
+    pixels = bytearray(width * height * 3)
+    index = [(0, 0, 0, 0)] * 64
+    r, g, b, a = 0, 0, 0, 255
+    run = 0
+    for i in range(width * height):
+        if run > 0:
+            run -= 1
+        else:
+            # An op is at most 5 bytes long. Checking here avoids IndexErrors
+            # when decoding the op.
+            if len(data) < pos + 5:
+                raise CorruptFrame("Truncated QOI stream")
+            op = data[pos]
+            pos += 1
+            if op == 0xFE:
+                r, g, b = data[pos], data[pos + 1], data[pos + 2]
+                pos += 3
+            elif op == 0xFF:
+                r, g, b, a = data[pos], data[pos + 1], data[pos + 2], data[pos + 3]
+                pos += 4
+            elif op & 0xC0 == 0x00:
+                r, g, b, a = index[op]
+            elif op & 0xC0 == 0x40:
+                r = (r + ((op >> 4) & 0x3) - 2) & 0xFF
+                g = (g + ((op >> 2) & 0x3) - 2) & 0xFF
+                b = (b + (op & 0x3) - 2) & 0xFF
+            elif op & 0xC0 == 0x80:
+                dg = (op & 0x3F) - 32
+                op2 = data[pos]
+                pos += 1
+                r = (r + dg + ((op2 >> 4) & 0xF) - 8) & 0xFF
+                g = (g + dg) & 0xFF
+                b = (b + dg + (op2 & 0xF) - 8) & 0xFF
+            else:
+                run = op & 0x3F
+            index[(r * 3 + g * 5 + b * 7 + a * 11) % 64] = (r, g, b, a)
+        pixels[i * 3:i * 3 + 3] = bytes((r, g, b))
+
+    if data[pos:pos + len(QOI_END_MARKER)] != QOI_END_MARKER:
+        raise CorruptFrame("Invalid QOI end marker")
+    pos += len(QOI_END_MARKER)
+    return width, height, pixels, pos - offset
+
+# Encode an RGB image into a PNG file.
+# @param filename: The name of the PNG file to create.
+# @param width: The width of the image.
+# @param height: The height of the image.
+# @param pixels: RGB triplets of the image in row-major order.
+def write_png(filename, width, height, pixels):
+    # Build a PNG chunk.
+    # @param tag: The 4-bytes type of the chunk.
+    # @param content: The content of the chunk.
+    # @return: The chunk as a bytes object.
+    def chunk(tag, content):
+        crc = zlib.crc32(tag + content) & 0xFFFFFFFF
+        return struct.pack(">I", len(content)) + tag + content + \
+            struct.pack(">I", crc)
+
+    # Each line is prefixed with the filter type, 0 = None.
+    stride = width * 3
+    raw = b"".join(b"\x00" + pixels[y * stride:(y + 1) * stride]
+                   for y in range(height))
+    # 8 bits per component, color type 2 = RGB.
+    ihdr = struct.pack(">IIBBBBB", width, height, 8, 2, 0, 0, 0)
+
+    fd = open(filename, "wb")
+    fd.write(b"\x89PNG\r\n\x1a\n")
+    fd.write(chunk(b"IHDR", ihdr))
+    fd.write(chunk(b"IDAT", zlib.compress(raw)))
+    fd.write(chunk(b"IEND", b""))
+    fd.close()
+
+# Decode and verify a captured frame.
+# @param data: A bytes object containing the serial output.
+# @param start: The offset of the QOI stream of the frame, right after the
+# magic.
+# @return: A tuple (width, height, pixels, size), see decode_qoi. Raises
+# CorruptFrame if the frame is invalid or truncated.
+def decode_frame(data, start):
+    width, height, pixels, size = decode_qoi(data, start)
+
+    # Verify the trailer.
+    if len(data) < start + size + 8:
+        raise CorruptFrame("Truncated trailer")
+    trailer_size, checksum = struct.unpack_from("<II", data, start + size)
+    if trailer_size != size:
+        raise CorruptFrame("Size mismatch")
+    if checksum != zlib.adler32(data[start:start + size]):
+        raise CorruptFrame("Invalid checksum")
+    return width, height, pixels, size
+
+# Main function of the script. Corrupted frames are reported and skipped.
+# @param dump_filename: The name of the file containing the serial output.
+# @param out_prefix: Prefix of the PNG files to create.
+# @return: The exit status of the script, 1 if any frame was corrupted.
+def main(dump_filename, out_prefix):
+    data = read_bytes(dump_filename)
+
+    num_frames = 0
+    num_corrupted = 0
+    pos = data.find(CAPTURE_MAGIC)
+    while pos != -1:
+        start = pos + len(CAPTURE_MAGIC)
+        try:
+            width, height, pixels, size = decode_frame(data, start)
+        except CorruptFrame as e:
+            print("Frame " + str(num_frames) + ": Corrupted, " + str(e))
+            num_frames += 1
+            num_corrupted += 1
+            # The frame cannot be trusted to find where it ends, look for the
+            # next magic right after this one.
+            pos = data.find(CAPTURE_MAGIC, start)
+            continue
+
+        filename = out_prefix + str(num_frames) + ".png"
+        write_png(filename, width, height, pixels)
+        print("Frame " + str(num_frames) + ": " + str(width) + "x" +
+              str(height) + ", " + str(size) + " bytes -> " + filename)
+        num_frames += 1
+
+        pos = data.find(CAPTURE_MAGIC, start + size + 8)
+
+    if num_frames == 0:
+        raise Exception("No captured frame found")
+    return 1 if num_corrupted else 0
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        raise Exception("Not enough args, expected <serial dump> [<prefix>]")
+    else:
+        prefix = sys.argv[2] if len(sys.argv) > 2 else "frame"
+        sys.exit(main(sys.argv[1], prefix))
@@ -0,0 +1,154 @@
+// Implementation of the frame capture. See capture.h.
+#include "capture.h"
+
+// Write raw bytes to the serial console.
+// @param buf: The bytes to write.
+// @param len: The number of bytes to write.
+extern "C" void writeSerial(void const * const buf, uint64_t const len);
+
+namespace Kr8 {
+// QOI chunk tags.
+static uint8_t const QOI_OP_INDEX = 0x00;
+static uint8_t const QOI_OP_DIFF = 0x40;
+static uint8_t const QOI_OP_LUMA = 0x80;
+static uint8_t const QOI_OP_RUN = 0xC0;
+static uint8_t const QOI_OP_RGB = 0xFE;
+// Maximum length of a QOI_OP_RUN.
+static uint8_t const QOI_MAX_RUN = 62;
+// Modulo used by the Adler-32 checksum.
+static uint32_t const ADLER_MOD = 65521;
+
+// Compute the position of a pixel in the QOI index.
+// @param px: The pixel, packed as 0xRRGGBBAA.
+// @return: The position of the pixel in the index.
+static uint8_t qoiHash(uint32_t const px) {
+    uint32_t const r = px >> 24;
+    uint32_t const g = (px >> 16) & 0xFF;
+    uint32_t const b = (px >> 8) & 0xFF;
+    uint32_t const a = px & 0xFF;
+    return (r * 3 + g * 5 + b * 7 + a * 11) % 64;
+}
+
+FrameCapture::FrameCapture(uint16_t const width, uint16_t const height) :
+    remainingPixels((uint32_t)width * height),
+    prev(0x000000FF),
+    run(0),
+    size(0),
+    adlerA(1),
+    adlerB(0),
+    bufLen(0) {
+    for (uint8_t i = 0; i < 64; ++i) {
+        index[i] = 0;
+    }
+
+    // The magic is not part of the QOI stream, hence it does not go through
+    // put().
+    writeSerial(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+
+    // QOI header: magic, big endian width and height, number of channels (3 =
+    // RGB) and colorspace (0 = sRGB with linear alpha).
+    put('q');
+    put('o');
+    put('i');
+    put('f');
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        put(((uint32_t)width >> shift) & 0xFF);
+    }
+    for (int8_t shift = 24; shift >= 0; shift -= 8) {
+        put(((uint32_t)height >> shift) & 0xFF);
+    }
+    put(3);
+    put(0);
+}
+
+void FrameCapture::putPixel(uint8_t const r, uint8_t const g, uint8_t const b) {
+    uint32_t const px = ((uint32_t)r << 24) | ((uint32_t)g << 16) |
+        ((uint32_t)b << 8) | 0xFF;
+    remainingPixels--;
+
+    if (px == prev) {
+        run++;
+        if (run == QOI_MAX_RUN || !remainingPixels) {
+            put(QOI_OP_RUN | (run - 1));
+            run = 0;
+        }
+        return;
+    }
+
+    if (run) {
+        put(QOI_OP_RUN | (run - 1));
+        run = 0;
+    }
+
+    uint8_t const hash = qoiHash(px);
+    if (index[hash] == px) {
+        put(QOI_OP_INDEX | hash);
+    } else {
+        index[hash] = px;
+
+        // Differences with the previous pixel, wrapping around.
+        int8_t const dr = (int8_t)(r - (uint8_t)(prev >> 24));
+        int8_t const dg = (int8_t)(g - (uint8_t)(prev >> 16));
+        int8_t const db = (int8_t)(b - (uint8_t)(prev >> 8));
+        int8_t const dgr = dr - dg;
+        int8_t const dgb = db - dg;
+
+        if (-2 <= dr && dr <= 1 && -2 <= dg && dg <= 1 && -2 <= db && db <= 1) {
+            put(QOI_OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2));
+        } else if (-32 <= dg && dg <= 31 &&
+                   -8 <= dgr && dgr <= 7 &&
+                   -8 <= dgb && dgb <= 7) {
+            put(QOI_OP_LUMA | (dg + 32));
+            put(((dgr + 8) << 4) | (dgb + 8));
+        } else {
+            put(QOI_OP_RGB);
+            put(r);
+            put(g);
+            put(b);
+        }
+    }
+    prev = px;
+}
+
+void FrameCapture::end() {
+    // QOI end marker.
+    for (uint8_t i = 0; i < 7; ++i) {
+        put(0x00);
+    }
+    put(0x01);
+    flush();
+
+    // The trailer is not part of the QOI stream.
+    uint32_t const checksum = (adlerB << 16) | adlerA;
+    uint8_t trailer[8];
+    for (uint8_t i = 0; i < 4; ++i) {
+        trailer[i] = (size >> (8 * i)) & 0xFF;
+        trailer[4 + i] = (checksum >> (8 * i)) & 0xFF;
+    }
+    writeSerial(trailer, sizeof(trailer));
+}
+
+void FrameCapture::put(uint8_t const byte) {
+    size++;
+    adlerA += byte;
+    if (adlerA >= ADLER_MOD) {
+        adlerA -= ADLER_MOD;
+    }
+    adlerB += adlerA;
+    if (adlerB >= ADLER_MOD) {
+        adlerB -= ADLER_MOD;
+    }
+
+    buf[bufLen++] = byte;
+    if (bufLen == BUF_SIZE) {
+        flush();
+    }
+}
+
+void FrameCapture::flush() {
+    if (bufLen) {
+        writeSerial(buf, bufLen);
+        bufLen = 0;
+    }
+}
+}
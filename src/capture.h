@@ -0,0 +1,70 @@
+// Frame capture through the serial console. This is the only way to get an
+// image out of a headless machine. Since the serial console is slow, the frame
+// is compressed using the QOI format (https://qoiformat.org) on the fly while
+// being streamed. decode_capture.py can be used on the host to extract the
+// frames from the serial output and convert them to PNG.
+//
+// A captured frame has the following layout on the serial console:
+//  - CAPTURE_MAGIC (8 bytes).
+//  - The QOI stream of the frame, including the QOI header and end marker.
+//  - The size of the QOI stream in bytes (DWORD, little endian).
+//  - The Adler-32 checksum of the QOI stream (DWORD, little endian).
+#pragma once
+#include <stdint.h>
+
+namespace Kr8 {
+// Magic value announcing a captured frame in the serial output. This contains
+// NUL chars which are never part of log messages.
+static uint8_t const CAPTURE_MAGIC[8] = {'\0', 'K', 'R', '8', 'C', 'A', 'P', '\0'};
+
+// Stream a single frame, compressed, through the serial console. The pixels of
+// the frame are pushed one by one in row-major order. Nothing else should be
+// printed to the serial console until the capture is complete.
+class FrameCapture {
+    public:
+    // Start the capture of a frame. This sends the magic and QOI header.
+    // @param width: The width of the frame in pixels.
+    // @param height: The height of the frame in pixels.
+    FrameCapture(uint16_t const width, uint16_t const height);
+
+    // Push the next pixel of the frame.
+    // @param r: 8-bit Red component.
+    // @param g: 8-bit Green component.
+    // @param b: 8-bit Blue component.
+    void putPixel(uint8_t const r, uint8_t const g, uint8_t const b);
+
+    // Complete the capture. This must be called once all the pixels have been
+    // pushed. This sends the QOI end marker, the size and the checksum.
+    void end();
+
+    private:
+    // Append a byte to the QOI stream.
+    // @param byte: The byte to append.
+    void put(uint8_t const byte);
+
+    // Write the pending bytes to the serial console.
+    void flush();
+
+    // Size of the buffer accumulating bytes before writing them to the serial
+    // console. This is to avoid a syscall per byte.
+    static uint16_t const BUF_SIZE = 256;
+
+    // Number of pixels that are yet to be pushed.
+    uint32_t remainingPixels;
+    // Previous pixel, packed as 0xRRGGBBAA.
+    uint32_t prev;
+    // QOI index of previously seen pixels, packed as 0xRRGGBBAA.
+    uint32_t index[64];
+    // Length of the current run of pixels identical to prev.
+    uint8_t run;
+    // Size of the QOI stream so far.
+    uint32_t size;
+    // Adler-32 checksum components of the QOI stream so far.
+    uint32_t adlerA;
+    uint32_t adlerB;
+    // Pending bytes.
+    uint8_t buf[BUF_SIZE];
+    // Number of pending bytes in buf.
+    uint16_t bufLen;
+};
+}
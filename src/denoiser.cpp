@@ -0,0 +1,389 @@
+// Implementation of the A-Trous wavelet denoiser. See denoiser.h.
+#include "denoiser.h"
+#include <immintrin.h>
+
+namespace Kr8 {
+// Coefficients of the 1D B3-spline kernel. The 5x5 kernel is the outer product
+// of this kernel with itself.
+static float const KERNEL[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f,
+                                1.0f / 4.0f, 1.0f / 16.0f};
+// The color and albedo edge-stopping functions are Gaussians:
+// exp(-|c_p - c_q|^2 / sigma^2). The depth edge-stopping function is
+// exp(-|z_p - z_q| / (sigma * z_p * step)).
+// Standard deviation of the color edge-stopping function for the first
+// iteration. This is divided by 2 at each iteration since the noise is reduced
+// by the previous iterations.
+static float const SIGMA_COLOR = 1.0f;
+// Standard deviation of the albedo edge-stopping function.
+static float const SIGMA_ALBEDO = 0.1f;
+// Scale of the depth edge-stopping function, relative to the depth of the
+// center pixel and the step of the kernel.
+static float const SIGMA_DEPTH = 0.05f;
+// The normal edge-stopping function is max(0, dot(n_p, n_q))^(2^N) with N
+// being this value.
+static uint8_t const NORMAL_EXP_LOG2 = 5;
+// Small value added to the albedo before demodulating the color to avoid
+// divisions by 0 on black surfaces.
+static float const ALBEDO_EPSILON = 1e-3f;
+// Small value added to the depth before computing relative differences.
+static float const DEPTH_EPSILON = 1e-6f;
+// Number of floats in an AVX register.
+static uint8_t const LANES = 8;
+// log2(e), used to compute exp(x) as 2^(x * log2(e)).
+static float const LOG2_E = 1.44269504f;
+// Lower bound of the exponent in exp2 computations. This avoids producing
+// denormals, weights below 2^-126 are irrelevant anyway.
+static float const EXP2_MIN = -126.0f;
+// Coefficients of the polynomial approximating 2^f for f in [0, 1), from
+// degree 1 to 5. These are the Taylor coefficients ln(2)^k / k!, the relative
+// error is below 2e-4.
+static float const EXP2_POLY[5] = {6.9314718e-1f, 2.4022651e-1f, 5.5504109e-2f,
+                                   9.6181291e-3f, 1.3333558e-3f};
+
+// Fast approximation of exp(-x) on 8 floats.
+// @param x: The values, expected to be >= 0.
+// @return: exp(-x) for each value of x.
+static __m256 expNeg8(__m256 const x) {
+    // exp(-x) = 2^y with y = -x * log2(e) = n + f, n being an integer and f in
+    // [0, 1).
+    __m256 const y = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(-LOG2_E)),
+                                   _mm256_set1_ps(EXP2_MIN));
+    __m256 const n = _mm256_floor_ps(y);
+    __m256 const f = _mm256_sub_ps(y, n);
+
+    __m256 poly = _mm256_set1_ps(EXP2_POLY[4]);
+    for (int8_t k = 3; k >= 0; --k) {
+        poly = _mm256_add_ps(_mm256_mul_ps(poly, f),
+                             _mm256_set1_ps(EXP2_POLY[k]));
+    }
+    poly = _mm256_add_ps(_mm256_mul_ps(poly, f), _mm256_set1_ps(1.0f));
+
+    // 2^n is built by writing n in the exponent bits of a float. AVX does not
+    // have 256-bit integer instructions hence this is done on both 128-bit
+    // halves.
+    __m256i const ni = _mm256_cvtps_epi32(n);
+    __m128i const bias = _mm_set1_epi32(127);
+    __m128i const lo = _mm_slli_epi32(
+        _mm_add_epi32(_mm256_castsi256_si128(ni), bias), 23);
+    __m128i const hi = _mm_slli_epi32(
+        _mm_add_epi32(_mm256_extractf128_si256(ni, 1), bias), 23);
+    __m256 const pow2n = _mm256_castsi256_ps(
+        _mm256_insertf128_si256(_mm256_castsi128_si256(lo), hi, 1));
+    return _mm256_mul_ps(poly, pow2n);
+}
+
+// Fast approximation of exp(-x), scalar version of expNeg8.
+// @param x: The value, expected to be >= 0.
+// @return: exp(-x).
+static float expNeg(float const x) {
+    float y = -x * LOG2_E;
+    y = (y > EXP2_MIN) ? y : EXP2_MIN;
+    int32_t n = (int32_t)y;
+    n = ((float)n > y) ? n - 1 : n;
+    float const f = y - (float)n;
+
+    float poly = EXP2_POLY[4];
+    for (int8_t k = 3; k >= 0; --k) {
+        poly = poly * f + EXP2_POLY[k];
+    }
+    poly = poly * f + 1.0f;
+
+    union {
+        uint32_t u;
+        float f;
+    } pow2n;
+    pow2n.u = (uint32_t)(n + 127) << 23;
+    return poly * pow2n.f;
+}
+
+// Compute the size of a plane in bytes. Planes are padded to a multiple of 32
+// bytes so that all scratch planes are aligned on AVX registers size.
+// @param width: The width of the plane.
+// @param height: The height of the plane.
+// @return: The padded size of the plane in bytes.
+static uint64_t planeSize(uint16_t const width, uint16_t const height) {
+    uint64_t const size = (uint64_t)width * height * sizeof(float);
+    return (size + 31) & ~((uint64_t)31);
+}
+
+uint64_t Denoiser::scratchSize(uint16_t const width, uint16_t const height) {
+    return 3 * planeSize(width, height);
+}
+
+Denoiser::Denoiser(uint16_t const width,
+                   uint16_t const height,
+                   void * const scratch) :
+    width(width),
+    height(height),
+    tmp{(float*)scratch,
+        (float*)((uint8_t*)scratch + planeSize(width, height)),
+        (float*)((uint8_t*)scratch + 2 * planeSize(width, height))} {}
+
+void Denoiser::denoise(struct GBuffer const& gbuf) {
+    uint32_t const numPixels = (uint32_t)width * height;
+    __m256 const eps = _mm256_set1_ps(ALBEDO_EPSILON);
+
+    // The filter is applied on the illumination rather than on the color
+    // itself, so that texture details are not blurred. Demodulate the albedo
+    // out of the color in place.
+    for (uint8_t c = 0; c < 3; ++c) {
+        float * const color = gbuf.color[c];
+        float const * const albedo = gbuf.albedo[c];
+        uint32_t i = 0;
+        for (; i + LANES <= numPixels; i += LANES) {
+            __m256 const a = _mm256_add_ps(_mm256_loadu_ps(albedo + i), eps);
+            __m256 const col = _mm256_loadu_ps(color + i);
+            _mm256_storeu_ps(color + i, _mm256_div_ps(col, a));
+        }
+        for (; i < numPixels; ++i) {
+            color[i] /= albedo[i] + ALBEDO_EPSILON;
+        }
+    }
+
+    // Iterations ping-pong between the color buffer of the GBuffer and the
+    // scratch planes.
+    struct Pass pass;
+    pass.step = 1;
+    pass.invSigmaColor2 = 1.0f / (SIGMA_COLOR * SIGMA_COLOR);
+    for (uint8_t i = 0; i < NUM_ITERATIONS; ++i) {
+        for (uint8_t c = 0; c < 3; ++c) {
+            pass.src[c] = (i % 2) ? tmp[c] : gbuf.color[c];
+            pass.dst[c] = (i % 2) ? gbuf.color[c] : tmp[c];
+        }
+
+        // Tiles only read from the source planes and write disjoint parts of
+        // the destination planes, they can be processed in any order. They are
+        // all processed on the current cpu since the bootstrap does not start
+        // the application processors.
+        for (uint16_t y0 = 0; y0 < height; y0 += TILE_SIZE) {
+            uint16_t const y1 = (height - y0 < TILE_SIZE) ?
+                height : y0 + TILE_SIZE;
+            for (uint16_t x0 = 0; x0 < width; x0 += TILE_SIZE) {
+                uint16_t const x1 = (width - x0 < TILE_SIZE) ?
+                    width : x0 + TILE_SIZE;
+                filterTile(gbuf, pass, x0, y0, x1, y1);
+            }
+        }
+
+        pass.step *= 2;
+        pass.invSigmaColor2 *= 4.0f;
+    }
+
+    // Re-modulate the albedo into the filtered illumination. The filtered
+    // illumination is in the scratch planes if the number of iterations is
+    // odd.
+    for (uint8_t c = 0; c < 3; ++c) {
+        float * const color = gbuf.color[c];
+        float const * const illum = (NUM_ITERATIONS % 2) ? tmp[c] : color;
+        float const * const albedo = gbuf.albedo[c];
+        uint32_t i = 0;
+        for (; i + LANES <= numPixels; i += LANES) {
+            __m256 const a = _mm256_add_ps(_mm256_loadu_ps(albedo + i), eps);
+            __m256 const il = _mm256_loadu_ps(illum + i);
+            _mm256_storeu_ps(color + i, _mm256_mul_ps(il, a));
+        }
+        for (; i < numPixels; ++i) {
+            color[i] = illum[i] * (albedo[i] + ALBEDO_EPSILON);
+        }
+    }
+}
+
+void Denoiser::filterTile(struct GBuffer const& gbuf,
+                          struct Pass const& pass,
+                          uint16_t const x0,
+                          uint16_t const y0,
+                          uint16_t const x1,
+                          uint16_t const y1) const {
+    // Number of pixels between the center and the outermost taps.
+    uint32_t const reach = 2 * pass.step;
+    for (uint16_t y = y0; y < y1; ++y) {
+        uint16_t x = x0;
+        while (x < x1) {
+            // Use the AVX version whenever the 8 pixels fit in the tile and
+            // all the taps are within the image horizontally. Taps outside
+            // the image vertically are skipped by both versions.
+            if (x + LANES <= x1 && x >= reach &&
+                x + (LANES - 1) + reach < width) {
+                filterPixels8(gbuf, pass, x, y);
+                x += LANES;
+            } else {
+                filterPixel(gbuf, pass, x, y);
+                x += 1;
+            }
+        }
+    }
+}
+
+void Denoiser::filterPixels8(struct GBuffer const& gbuf,
+                             struct Pass const& pass,
+                             uint16_t const x,
+                             uint16_t const y) const {
+    uint32_t const p = (uint32_t)y * width + x;
+    __m256 const zero = _mm256_setzero_ps();
+    __m256 const absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+    __m256 const invSigmaColor2 = _mm256_set1_ps(pass.invSigmaColor2);
+    __m256 const invSigmaAlbedo2 =
+        _mm256_set1_ps(1.0f / (SIGMA_ALBEDO * SIGMA_ALBEDO));
+    __m256 const invSigmaDepth =
+        _mm256_set1_ps(1.0f / (SIGMA_DEPTH * pass.step));
+
+    // Features of the 8 center pixels.
+    __m256 const pr = _mm256_loadu_ps(pass.src[0] + p);
+    __m256 const pg = _mm256_loadu_ps(pass.src[1] + p);
+    __m256 const pb = _mm256_loadu_ps(pass.src[2] + p);
+    __m256 const par = _mm256_loadu_ps(gbuf.albedo[0] + p);
+    __m256 const pag = _mm256_loadu_ps(gbuf.albedo[1] + p);
+    __m256 const pab = _mm256_loadu_ps(gbuf.albedo[2] + p);
+    __m256 const pnx = _mm256_loadu_ps(gbuf.normal[0] + p);
+    __m256 const pny = _mm256_loadu_ps(gbuf.normal[1] + p);
+    __m256 const pnz = _mm256_loadu_ps(gbuf.normal[2] + p);
+    __m256 const pz = _mm256_loadu_ps(gbuf.depth + p);
+    // Scale applied to depth differences. Make them relative to the center's
+    // depth.
+    __m256 const depthScale = _mm256_mul_ps(invSigmaDepth,
+        _mm256_rcp_ps(_mm256_add_ps(pz, _mm256_set1_ps(DEPTH_EPSILON))));
+
+    // The center tap only uses the kernel weight. This guarantees that the
+    // sum of weights is never 0, even for pixels without normal.
+    __m256 sumW = _mm256_set1_ps(KERNEL[2] * KERNEL[2]);
+    __m256 sumR = _mm256_mul_ps(sumW, pr);
+    __m256 sumG = _mm256_mul_ps(sumW, pg);
+    __m256 sumB = _mm256_mul_ps(sumW, pb);
+
+    for (int8_t j = -2; j <= 2; ++j) {
+        int32_t const qy = (int32_t)y + j * pass.step;
+        if (qy < 0 || qy >= height) {
+            continue;
+        }
+        for (int8_t i = -2; i <= 2; ++i) {
+            if (!i && !j) {
+                continue;
+            }
+            uint32_t const q = qy * width + (x + i * pass.step);
+
+            // Color distance.
+            __m256 const qr = _mm256_loadu_ps(pass.src[0] + q);
+            __m256 const qg = _mm256_loadu_ps(pass.src[1] + q);
+            __m256 const qb = _mm256_loadu_ps(pass.src[2] + q);
+            __m256 const dr = _mm256_sub_ps(qr, pr);
+            __m256 const dg = _mm256_sub_ps(qg, pg);
+            __m256 const db = _mm256_sub_ps(qb, pb);
+            __m256 distColor = _mm256_mul_ps(dr, dr);
+            distColor = _mm256_add_ps(distColor, _mm256_mul_ps(dg, dg));
+            distColor = _mm256_add_ps(distColor, _mm256_mul_ps(db, db));
+            distColor = _mm256_mul_ps(distColor, invSigmaColor2);
+
+            // Albedo distance.
+            __m256 const dar = _mm256_sub_ps(
+                _mm256_loadu_ps(gbuf.albedo[0] + q), par);
+            __m256 const dag = _mm256_sub_ps(
+                _mm256_loadu_ps(gbuf.albedo[1] + q), pag);
+            __m256 const dab = _mm256_sub_ps(
+                _mm256_loadu_ps(gbuf.albedo[2] + q), pab);
+            __m256 distAlbedo = _mm256_mul_ps(dar, dar);
+            distAlbedo = _mm256_add_ps(distAlbedo, _mm256_mul_ps(dag, dag));
+            distAlbedo = _mm256_add_ps(distAlbedo, _mm256_mul_ps(dab, dab));
+            distAlbedo = _mm256_mul_ps(distAlbedo, invSigmaAlbedo2);
+
+            // Depth distance.
+            __m256 distDepth = _mm256_sub_ps(
+                _mm256_loadu_ps(gbuf.depth + q), pz);
+            distDepth = _mm256_and_ps(distDepth, absMask);
+            distDepth = _mm256_mul_ps(distDepth, depthScale);
+
+            // The color, albedo and depth edge-stopping functions are
+            // exp(-dist). Sum the distances together to only compute a single
+            // exponential.
+            __m256 dist = _mm256_add_ps(distColor, distAlbedo);
+            dist = _mm256_add_ps(dist, distDepth);
+
+            // Normal edge-stopping function.
+            __m256 dot = _mm256_mul_ps(pnx,
+                _mm256_loadu_ps(gbuf.normal[0] + q));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(pny,
+                _mm256_loadu_ps(gbuf.normal[1] + q)));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(pnz,
+                _mm256_loadu_ps(gbuf.normal[2] + q)));
+            __m256 weightNormal = _mm256_max_ps(dot, zero);
+            for (uint8_t k = 0; k < NORMAL_EXP_LOG2; ++k) {
+                weightNormal = _mm256_mul_ps(weightNormal, weightNormal);
+            }
+
+            __m256 const w = _mm256_mul_ps(
+                _mm256_set1_ps(KERNEL[i + 2] * KERNEL[j + 2]),
+                _mm256_mul_ps(weightNormal, expNeg8(dist)));
+            sumW = _mm256_add_ps(sumW, w);
+            sumR = _mm256_add_ps(sumR, _mm256_mul_ps(w, qr));
+            sumG = _mm256_add_ps(sumG, _mm256_mul_ps(w, qg));
+            sumB = _mm256_add_ps(sumB, _mm256_mul_ps(w, qb));
+        }
+    }
+
+    _mm256_storeu_ps(pass.dst[0] + p, _mm256_div_ps(sumR, sumW));
+    _mm256_storeu_ps(pass.dst[1] + p, _mm256_div_ps(sumG, sumW));
+    _mm256_storeu_ps(pass.dst[2] + p, _mm256_div_ps(sumB, sumW));
+}
+
+void Denoiser::filterPixel(struct GBuffer const& gbuf,
+                           struct Pass const& pass,
+                           uint16_t const x,
+                           uint16_t const y) const {
+    uint32_t const p = (uint32_t)y * width + x;
+    float const invSigmaAlbedo2 = 1.0f / (SIGMA_ALBEDO * SIGMA_ALBEDO);
+    float const depthScale = 1.0f / (SIGMA_DEPTH * pass.step *
+        (gbuf.depth[p] + DEPTH_EPSILON));
+
+    // The center tap only uses the kernel weight, see filterPixels8.
+    float sumW = KERNEL[2] * KERNEL[2];
+    float sum[3];
+    for (uint8_t c = 0; c < 3; ++c) {
+        sum[c] = sumW * pass.src[c][p];
+    }
+
+    for (int8_t j = -2; j <= 2; ++j) {
+        int32_t const qy = (int32_t)y + j * pass.step;
+        if (qy < 0 || qy >= height) {
+            continue;
+        }
+        for (int8_t i = -2; i <= 2; ++i) {
+            int32_t const qx = (int32_t)x + i * pass.step;
+            if ((!i && !j) || qx < 0 || qx >= width) {
+                continue;
+            }
+            uint32_t const q = qy * width + qx;
+
+            float distColor = 0.0f;
+            float distAlbedo = 0.0f;
+            float dot = 0.0f;
+            for (uint8_t c = 0; c < 3; ++c) {
+                float const dc = pass.src[c][q] - pass.src[c][p];
+                float const da = gbuf.albedo[c][q] - gbuf.albedo[c][p];
+                distColor += dc * dc;
+                distAlbedo += da * da;
+                dot += gbuf.normal[c][q] * gbuf.normal[c][p];
+            }
+            distColor *= pass.invSigmaColor2;
+            distAlbedo *= invSigmaAlbedo2;
+            float distDepth = gbuf.depth[q] - gbuf.depth[p];
+            distDepth = (distDepth < 0.0f) ? -distDepth : distDepth;
+            distDepth *= depthScale;
+
+            float weightNormal = (dot > 0.0f) ? dot : 0.0f;
+            for (uint8_t k = 0; k < NORMAL_EXP_LOG2; ++k) {
+                weightNormal *= weightNormal;
+            }
+
+            float const w = KERNEL[i + 2] * KERNEL[j + 2] * weightNormal *
+                expNeg(distColor + distAlbedo + distDepth);
+            sumW += w;
+            for (uint8_t c = 0; c < 3; ++c) {
+                sum[c] += w * pass.src[c][q];
+            }
+        }
+    }
+
+    for (uint8_t c = 0; c < 3; ++c) {
+        pass.dst[c][p] = sum[c] / sumW;
+    }
+}
+}
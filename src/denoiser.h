@@ -0,0 +1,119 @@
+// Edge-avoiding A-Trous wavelet denoiser. This filter is applied on the
+// accumulated color of a frame, before it is presented on the FrameBuffer, and
+// makes it possible to reach acceptable image quality with a low number of
+// samples per pixel.
+// The filter is guided by auxiliary buffers written by the renderer alongside
+// the color: albedo, normal and depth of the first hit. Those are used to avoid
+// blurring across geometric and texture edges.
+#pragma once
+#include <stdint.h>
+
+namespace Kr8 {
+// Set of buffers produced by the renderer for a single frame. All buffers are
+// planar (one array per component) and hold width * height floats in row-major
+// order. The planar layout allows the denoiser to process 8 consecutive pixels
+// at once using AVX.
+struct GBuffer {
+    // The width in pixels.
+    uint16_t const width;
+    // The height in pixels.
+    uint16_t const height;
+    // Red, green and blue planes of the accumulated color, that is the average
+    // of all samples taken so far. This is where the denoised color is written.
+    float * const color[3];
+    // Red, green and blue planes of the albedo of the first hit.
+    float * const albedo[3];
+    // X, Y and Z planes of the normal of the first hit. Normals are expected to
+    // be normalized, or 0 for pixels where nothing was hit.
+    float * const normal[3];
+    // Depth of the first hit.
+    float * const depth;
+};
+
+// Denoiser implementing the edge-avoiding A-Trous wavelet transform (Dammertz
+// et al. 2010). The filter is a 5x5 B3-spline kernel applied NUM_ITERATIONS
+// times with a step doubling at each iteration, the weight of each tap being
+// attenuated by the difference in color, albedo, normal and depth with the
+// center pixel. As in the paper, the color and albedo edge-stopping functions
+// are Gaussians.
+class Denoiser {
+    public:
+    // Number of iterations of the A-Trous transform. The footprint of the
+    // filter is 4 * 2^NUM_ITERATIONS + 1 pixels wide.
+    static uint8_t const NUM_ITERATIONS = 5;
+    // Size of the side of the square tiles the image is split into. Tiles are
+    // independent within an iteration.
+    static uint16_t const TILE_SIZE = 64;
+
+    // Compute the size of the scratch memory required to denoise an image.
+    // @param width: The width of the image in pixels.
+    // @param height: The height of the image in pixels.
+    // @return: The size of the scratch memory in bytes.
+    static uint64_t scratchSize(uint16_t const width, uint16_t const height);
+
+    // Create a denoiser for images of a given size.
+    // @param width: The width of the images to denoise.
+    // @param height: The height of the images to denoise.
+    // @param scratch: Scratch memory of at least scratchSize(width, height)
+    // bytes. This memory must remain valid for the lifetime of the Denoiser.
+    Denoiser(uint16_t const width, uint16_t const height, void * const scratch);
+
+    // Denoise the color buffer of a GBuffer in place. The GBuffer must have
+    // the same size as the one given to the constructor.
+    // @param gbuf: The GBuffer to denoise.
+    void denoise(struct GBuffer const& gbuf);
+
+    private:
+    // Buffers used by one iteration of the filter.
+    struct Pass {
+        // Illumination planes to read from.
+        float const * src[3];
+        // Illumination planes to write to.
+        float * dst[3];
+        // Distance between two taps of the kernel.
+        uint16_t step;
+        // 1 / sigma^2 of the color edge-stopping function.
+        float invSigmaColor2;
+    };
+
+    // Apply one iteration of the filter on a tile.
+    // @param gbuf: The GBuffer being denoised.
+    // @param pass: The buffers and parameters of the current iteration.
+    // @param x0, y0: The coordinates of the top left corner of the tile.
+    // @param x1, y1: The coordinates of the bottom right corner of the tile,
+    // exclusive.
+    void filterTile(struct GBuffer const& gbuf,
+                    struct Pass const& pass,
+                    uint16_t const x0,
+                    uint16_t const y0,
+                    uint16_t const x1,
+                    uint16_t const y1) const;
+
+    // Filter 8 consecutive pixels on the same line using AVX. All the taps of
+    // the kernel must be within the image horizontally.
+    // @param gbuf: The GBuffer being denoised.
+    // @param pass: The buffers and parameters of the current iteration.
+    // @param x: The column of the first pixel.
+    // @param y: The line of the pixels.
+    void filterPixels8(struct GBuffer const& gbuf,
+                       struct Pass const& pass,
+                       uint16_t const x,
+                       uint16_t const y) const;
+
+    // Filter a single pixel. This is used on the borders of the image where
+    // some taps of the kernel are outside the image.
+    // @param gbuf: The GBuffer being denoised.
+    // @param pass: The buffers and parameters of the current iteration.
+    // @param x: The column of the pixel.
+    // @param y: The line of the pixel.
+    void filterPixel(struct GBuffer const& gbuf,
+                     struct Pass const& pass,
+                     uint16_t const x,
+                     uint16_t const y) const;
+
+    uint16_t const width;
+    uint16_t const height;
+    // Scratch illumination planes, each holding width * height floats.
+    float * const tmp[3];
+};
+}
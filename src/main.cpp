@@ -2,6 +2,8 @@
 // in the VGA buffer.
 #include <stdint.h>
 #include <type_traits>
+#include "capture.h"
+#include "denoiser.h"
 
 // Read the current value of the Time-Stamp counter.
 // @return: Current value of TSC on this cpu.
@@ -15,6 +17,12 @@ extern "C" uint64_t getTscFreq(void);
 // @param msg: The NUL-terminated string to print out.
 extern "C" void logSerial(char const * const msg);
 
+// Increment or decrement the program break.
+// @param increment: Increment in bytes. A value of 0 returns the current
+// program break.
+// @return: The new value of the program break.
+extern "C" void * sbrk(int64_t const increment);
+
 namespace Kr8 {
 // Information on the VESA frame buffer.
 struct FrameBufferInfo {
@@ -76,6 +84,27 @@ class FrameBuffer {
             ((b & ((1<<fbInfo->blueMaskSize)-1)) << fbInfo->blueMaskPos);
         }
 
+        // Create a color from a uint32_t as understood by the framebuffer. This
+        // is the inverse of toUint32.
+        // @param value: The uint32_t describing the color.
+        // @param fbInfo: Information on the framebuffer. This is used to know
+        // the position and size of the R, G and B masks.
+        // @return: The corresponding Color.
+        static Color fromUint32(uint32_t const value,
+                                struct FrameBufferInfo const * const fbInfo) {
+            return Color(
+                (value >> fbInfo->redMaskPos) & ((1<<fbInfo->redMaskSize)-1),
+                (value >> fbInfo->greenMaskPos) & ((1<<fbInfo->greenMaskSize)-1),
+                (value >> fbInfo->blueMaskPos) & ((1<<fbInfo->blueMaskSize)-1));
+        }
+
+        // @return: The 8-bit Red component.
+        uint8_t red() const { return r; }
+        // @return: The 8-bit Green component.
+        uint8_t green() const { return g; }
+        // @return: The 8-bit Blue component.
+        uint8_t blue() const { return b; }
+
         private:
         uint8_t const r;
         uint8_t const g;
@@ -124,6 +153,50 @@ class FrameBuffer {
         *(uint32_t*)fb = color.toUint32(fbInfo);
     }
 
+    // Read a pixel from the framebuffer.
+    // @param pos: The position of the pixel.
+    // @return: The color of the pixel.
+    template<typename T>
+    Color getPixel(Pos<T> const& pos) const {
+        uint16_t const x = pos.col(fbInfo);
+        uint16_t const y = pos.line(fbInfo);
+        uint8_t const * const fb = ((uint8_t*)(uint64_t)fbInfo->framebufferAddr) +
+            (y * fbInfo->bytesPerLine) + x * (fbInfo->bitsPerPixel / 8);
+        return Color::fromUint32(*(uint32_t const*)fb, fbInfo);
+    }
+
+    // Draw an image covering the entire framebuffer.
+    // @param rgb: The red, green and blue planes of the image, each holding
+    // width * height floats in row-major order. Components are expected to be
+    // within [0, 1] and are clamped otherwise.
+    void putImage(float const * const rgb[3]) {
+        for (uint16_t y = 0; y < fbInfo->height; ++y) {
+            for (uint16_t x = 0; x < fbInfo->width; ++x) {
+                uint32_t const i = (uint32_t)y * fbInfo->width + x;
+                uint8_t comp[3];
+                for (uint8_t c = 0; c < 3; ++c) {
+                    float const v = rgb[c][i];
+                    comp[c] = (v <= 0.0f) ? 0 :
+                        ((v >= 1.0f) ? 255 : (uint8_t)(v * 255.0f + 0.5f));
+                }
+                putPixel(Pos<uint16_t>(x, y), Color(comp[0], comp[1], comp[2]));
+            }
+        }
+    }
+
+    // Snapshot the content of the framebuffer and stream it through the serial
+    // console. See capture.h for the format.
+    void capture() const {
+        FrameCapture cap(fbInfo->width, fbInfo->height);
+        for (uint16_t y = 0; y < fbInfo->height; ++y) {
+            for (uint16_t x = 0; x < fbInfo->width; ++x) {
+                Color const color = getPixel(Pos<uint16_t>(x, y));
+                cap.putPixel(color.red(), color.green(), color.blue());
+            }
+        }
+        cap.end();
+    }
+
     private:
     struct FrameBufferInfo const * const fbInfo;
 };
@@ -140,6 +213,90 @@ uint16_t FrameBuffer::Pos<float>::col(struct FrameBufferInfo const * const fbInf
     return (uint16_t)(x * fbInfo->width);
 }
 
+// Denoise the accumulated color of a frame and present it on the framebuffer.
+// @param fb: The framebuffer to present the frame on.
+// @param denoiser: The denoiser to use, must have the same size as the frame.
+// @param gbuf: The buffers of the frame. The color is denoised in place.
+void presentFrame(FrameBuffer& fb, Denoiser& denoiser, struct GBuffer const& gbuf) {
+    denoiser.denoise(gbuf);
+    float const * const rgb[3] = {gbuf.color[0], gbuf.color[1], gbuf.color[2]};
+    fb.putImage(rgb);
+}
+
+// Allocate memory on the heap. There is no de-allocation for now.
+// @param size: The size of the allocation in bytes.
+// @return: The address of the allocated memory.
+void * allocate(uint64_t const size) {
+    void * const start = sbrk(0);
+    sbrk(size);
+    return start;
+}
+
+// Xorshift pseudo-random number generator.
+// @param state: The state of the generator, must not be 0.
+// @return: A pseudo-random float in [0, 1).
+float randomFloat(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return (state >> 8) * (1.0f / (1 << 24));
+}
+
+// Fill a GBuffer with a synthetic noisy frame. The scene is made of a wall
+// with a checkerboard texture, a tilted red panel in front of it and a green
+// floor. The color of each pixel is the average of a few samples with a
+// uniformly distributed noise, mimicking a path tracer at low sample counts.
+// @param gbuf: The GBuffer to fill.
+// @param spp: The number of samples per pixel.
+void renderTestFrame(struct GBuffer const& gbuf, uint8_t const spp) {
+    uint32_t rngState = 0x12345678;
+    for (uint16_t y = 0; y < gbuf.height; ++y) {
+        for (uint16_t x = 0; x < gbuf.width; ++x) {
+            uint32_t const i = (uint32_t)y * gbuf.width + x;
+            float const u = (float)x / gbuf.width;
+            float const v = (float)y / gbuf.height;
+
+            float albedo[3];
+            float normal[3];
+            float depth;
+            float illum;
+            if (v > 0.75f) {
+                // Floor, getting closer towards the bottom of the frame.
+                albedo[0] = 0.3f; albedo[1] = 0.6f; albedo[2] = 0.3f;
+                normal[0] = 0.0f; normal[1] = 1.0f; normal[2] = 0.0f;
+                depth = 10.0f - 32.0f * (v - 0.75f);
+                illum = 0.9f;
+            } else if (u > 0.33f && u < 0.66f && v > 0.2f) {
+                // Panel, lit from the side.
+                albedo[0] = 0.8f; albedo[1] = 0.2f; albedo[2] = 0.2f;
+                normal[0] = 0.6f; normal[1] = 0.0f; normal[2] = 0.8f;
+                depth = 5.0f;
+                illum = 0.4f + 0.6f * (u - 0.33f) / 0.33f;
+            } else {
+                // Checkerboard wall.
+                float const c = (((x / 32) + (y / 32)) % 2) ? 0.8f : 0.3f;
+                albedo[0] = c; albedo[1] = c; albedo[2] = c;
+                normal[0] = 0.0f; normal[1] = 0.0f; normal[2] = 1.0f;
+                depth = 10.0f;
+                illum = 0.6f;
+            }
+
+            for (uint8_t c = 0; c < 3; ++c) {
+                // Each sample is uniform in [0, 2 * illum) hence the expected
+                // value of the average is illum.
+                float sum = 0.0f;
+                for (uint8_t s = 0; s < spp; ++s) {
+                    sum += 2.0f * illum * randomFloat(rngState);
+                }
+                gbuf.color[c][i] = albedo[c] * sum / spp;
+                gbuf.albedo[c][i] = albedo[c];
+                gbuf.normal[c][i] = normal[c];
+            }
+            gbuf.depth[i] = depth;
+        }
+    }
+}
+
 // Simple implementation of an output stream printing to the serial console.
 class Ostream {
     public:
@@ -214,6 +371,28 @@ char const * const endl = "\n";
 // understand how to interact with the VESA framebuffer.
 extern "C" void _start(Kr8::FrameBufferInfo const * const fbInfo) {
     Kr8::FrameBuffer fb(fbInfo);
+
+    // Denoise a synthetic frame at 4 samples per pixel and present it.
+    uint16_t const width = fbInfo->width;
+    uint16_t const height = fbInfo->height;
+    uint64_t const planeSize = (uint64_t)width * height * sizeof(float);
+    float * const planes = (float*)Kr8::allocate(10 * planeSize);
+    uint32_t const n = (uint32_t)width * height;
+    Kr8::GBuffer const gbuf = {
+        width,
+        height,
+        {planes, planes + n, planes + 2 * n},
+        {planes + 3 * n, planes + 4 * n, planes + 5 * n},
+        {planes + 6 * n, planes + 7 * n, planes + 8 * n},
+        planes + 9 * n,
+    };
+    Kr8::Denoiser denoiser(width, height,
+        Kr8::allocate(Kr8::Denoiser::scratchSize(width, height)));
+    Kr8::renderTestFrame(gbuf, 4);
+    uint64_t const start = readTsc();
+    Kr8::presentFrame(fb, denoiser, gbuf);
+    uint64_t const end = readTsc();
+
     fb.putPixel(Kr8::FrameBuffer::Pos<float>(.33f, .33f), Kr8::FrameBuffer::Color(0, 255, 0));
     fb.putPixel(Kr8::FrameBuffer::Pos<float>(.66f, .33f), Kr8::FrameBuffer::Color(0, 255, 0));
     fb.putPixel(Kr8::FrameBuffer::Pos<float>(.33f, .66f), Kr8::FrameBuffer::Color(0, 255, 0));
@@ -227,4 +406,14 @@ extern "C" void _start(Kr8::FrameBufferInfo const * const fbInfo) {
 
     uint64_t const tsc_freq = getTscFreq();
     Kr8::sout << "TSC frequency = " << tsc_freq << " Hz" << Kr8::endl;
+    Kr8::sout << "Denoised and presented " << width << "x" << height <<
+        " frame in " << (end - start) * 1000 / tsc_freq << " ms" << Kr8::endl;
+
+#ifdef KR8_CAPTURE
+    // Only the capture variant of the application streams the frame, see
+    // capture.h.
+    Kr8::sout << "Capturing frame" << Kr8::endl;
+    fb.capture();
+    Kr8::sout << "Frame captured" << Kr8::endl;
+#endif
 }